@@ -2,6 +2,8 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <cstdio>
+#include "InputTrace.h"
 
 // Global camera and frustum parameters
 float angle_x = 0.0f, angle_y = 0.0f; // Rotation angles for scene
@@ -157,6 +159,7 @@ void draw_text(float x, float y, const std::string &text) {
 
 // Main render function
 void display() {
+    trace_frame_begin();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Setup perspective projection
@@ -187,32 +190,68 @@ void display() {
     draw_text(10, 580, info);
     draw_text(10, 560, "Arrow keys: Rotate  W/S: Move camera  F: Toggle frustum");
 
+    trace_frame_end(); // Stop the replay frame timer before the swap
     glutSwapBuffers();
 }
 
-// Handle keyboard input for camera and toggling
-void keyboard(unsigned char key, int x, int y) {
+// Apply a camera/toggle key (shared by live input and replay)
+void apply_key(unsigned char key) {
     key = tolower(key);
-    if (key == 27) { // ESC key
-        exit(0);
-    } else if (key == 'w') {
+    if (key == 'w') {
         camera_z -= 0.5f; // Move camera forward
     } else if (key == 's') {
         camera_z += 0.5f; // Move camera backward
     } else if (key == 'f') {
         show_frustum = !show_frustum; // Toggle frustum
     }
-    glutPostRedisplay();
 }
 
-// Handle special arrow keys for rotation
-void special_keys(int key, int x, int y) {
+// Apply an arrow key rotation (shared by live input and replay)
+void apply_special(int key) {
     switch (key) {
         case GLUT_KEY_UP:    angle_x += 5; break;
         case GLUT_KEY_DOWN:  angle_x -= 5; break;
         case GLUT_KEY_LEFT:  angle_y += 5; break;
         case GLUT_KEY_RIGHT: angle_y -= 5; break;
     }
+}
+
+// Camera state stored with each trace event
+void save_trace_state(std::vector<float> &state) {
+    state = { camera_z, angle_x, angle_y, show_frustum ? 1.0f : 0.0f };
+}
+
+// Restore the camera state recorded with a trace event
+void load_trace_state(const std::vector<float> &state) {
+    if (state.size() < 4) return;
+    camera_z = state[0];
+    angle_x = state[1];
+    angle_y = state[2];
+    show_frustum = state[3] != 0.0f;
+}
+
+// Re-run a recorded key event during replay
+void apply_trace_event(char type, int code) {
+    if (type == 'k') apply_key((unsigned char)code);
+    else apply_special(code);
+}
+
+// Handle keyboard input for camera and toggling
+void keyboard(unsigned char key, int x, int y) {
+    if (key == 27) { // ESC key
+        exit(0);
+    }
+    if (trace_replaying()) return; // Live input is ignored during replay
+    apply_key(key);
+    trace_record('k', key);
+    glutPostRedisplay();
+}
+
+// Handle special arrow keys for rotation
+void special_keys(int key, int x, int y) {
+    if (trace_replaying()) return;
+    apply_special(key);
+    trace_record('s', key);
     glutPostRedisplay();
 }
 
@@ -224,6 +263,11 @@ void reshape(int width, int height) {
 // Main entry point
 int main(int argc, char** argv) {
     glutInit(&argc, argv);
+
+    TraceHooks hooks = { save_trace_state, load_trace_state, apply_trace_event, nullptr };
+    if (!trace_init(argc, argv, "camera_z angle_x angle_y show_frustum", hooks))
+        return 1;
+
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(600, 600);
     glutCreateWindow("Enhanced 3D Clipping & Viewing Demonstration (C++)");
@@ -234,6 +278,8 @@ int main(int argc, char** argv) {
     glutSpecialFunc(special_keys);
     glutReshapeFunc(reshape);
 
+    trace_start(); // Begin recording or replaying if requested
+
     glutMainLoop(); // Enter event loop
 
     return 0;
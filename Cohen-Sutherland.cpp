@@ -3,6 +3,11 @@
 #include <sstream>
 #include <string>
 #include <iomanip>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "InputTrace.h"
 
 // ------------------------------
 // Box dimensions (Clipping volume)
@@ -44,84 +49,231 @@ std::string coordToStr(float x, float y, float z) {
 }
 
 // ------------------------------
-// Calculate outcode for a point relative to the clipping volume
+// Precision-tiered Cohen-Sutherland 3D Line Clipping
 // ------------------------------
-int computeOutCode(float x, float y, float z) {
+// Intersections are always taken from the ORIGINAL segment
+// (P = P0 + t * (P1 - P0)) and a plane is masked out once an endpoint has been
+// snapped to it, so rounding cannot bounce a point between planes: each
+// endpoint is clipped at most three times.
+//
+// The float pass also tracks a conservative bound on the error of every
+// computed endpoint. If a computed point lies within that bound of a plane, or
+// the visible interval is thinner than the error in t, the float answer is
+// reported as ambiguous and the segment is re-clipped in double precision.
+enum ClipResult {
+    CLIP_REJECT,
+    CLIP_ACCEPT,
+    CLIP_AMBIGUOUS
+};
+
+// Outcode of a point, ignoring the planes in 'mask'. 'err' is the error bound on
+// the point's coordinates; a coordinate within 'err' of a plane sets 'ambiguous'.
+template <typename T>
+int computeOutCodeT(const T p[3], T err, int mask, bool &ambiguous) {
+    const T lo[3] = { xmin, ymin, zmin };
+    const T hi[3] = { xmax, ymax, zmax };
+    const int loBit[3] = { LEFT, BOTTOM, NEAR };
+    const int hiBit[3] = { RIGHT, TOP, FAR_ };
+
     int code = INSIDE;
-    if (x < xmin) code |= LEFT;
-    else if (x > xmax) code |= RIGHT;
-    if (y < ymin) code |= BOTTOM;
-    else if (y > ymax) code |= TOP;
-    if (z < zmin) code |= NEAR;
-    else if (z > zmax) code |= FAR_;
+    for (int i = 0; i < 3; ++i) {
+        if (!(mask & loBit[i])) {
+            if (p[i] < lo[i]) code |= loBit[i];
+            if (err > 0 && std::fabs(p[i] - lo[i]) <= err) ambiguous = true;
+        }
+        if (!(mask & hiBit[i])) {
+            if (p[i] > hi[i]) code |= hiBit[i];
+            if (err > 0 && std::fabs(p[i] - hi[i]) <= err) ambiguous = true;
+        }
+    }
     return code;
 }
 
-// ------------------------------
-// Cohen-Sutherland 3D Line Clipping Algorithm
-// ------------------------------
-bool cohenSutherlandClip(float& x0, float& y0, float& z0, float& x1, float& y1, float& z1) {
-    int outcode0 = computeOutCode(x0, y0, z0);
-    int outcode1 = computeOutCode(x1, y1, z1);
-    bool accept = false;
+// Clip P0-P1 in precision T. On CLIP_ACCEPT, 'a' and 'b' hold the visible endpoints.
+// With trackError false no error bound is kept, so the result is never ambiguous.
+template <typename T>
+ClipResult cohenSutherlandClipT(const T p0[3], const T p1[3], T a[3], T b[3], bool trackError = true) {
+    const T u = trackError ? std::numeric_limits<T>::epsilon() : 0;
+    const T dir[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+
+    // Error of P0 + t * dir for t in [0, 1]: the subtraction, the division that
+    // produced t, the multiply and the add, with generous slack.
+    T scale = 0;
+    for (int i = 0; i < 3; ++i)
+        scale = std::max(scale, std::fabs(p0[i]) + std::fabs(dir[i]));
+    const T pointErr = 8 * u * scale;
+
+    for (int i = 0; i < 3; ++i) {
+        a[i] = p0[i];
+        b[i] = p1[i];
+    }
+    T ta = 0, tb = 1;
+    T errA = 0, errB = 0;      // Original endpoints are exact
+    int maskA = 0, maskB = 0;  // Planes each endpoint has been snapped to
+    bool ambiguous = false;
+
+    int codeA = computeOutCodeT(a, errA, maskA, ambiguous);
+    int codeB = computeOutCodeT(b, errB, maskB, ambiguous);
 
     while (true) {
-        if (!(outcode0 | outcode1)) {
-            // Trivial accept: both points are inside
-            accept = true;
-            break;
-        } else if (outcode0 & outcode1) {
-            // Trivial reject: both points share an outside zone
+        if (ambiguous)
+            return CLIP_AMBIGUOUS;
+        if (!(codeA | codeB))
             break;
+        if (codeA & codeB)
+            return CLIP_REJECT;
+
+        bool clipA = codeA != 0;
+        int code = clipA ? codeA : codeB;
+        int axis, bit;
+        T plane;
+        if      (code & TOP)    { axis = 1; bit = TOP;    plane = ymax; }
+        else if (code & BOTTOM) { axis = 1; bit = BOTTOM; plane = ymin; }
+        else if (code & RIGHT)  { axis = 0; bit = RIGHT;  plane = xmax; }
+        else if (code & LEFT)   { axis = 0; bit = LEFT;   plane = xmin; }
+        else if (code & FAR_)   { axis = 2; bit = FAR_;   plane = zmax; }
+        else                    { axis = 2; bit = NEAR;   plane = zmin; }
+
+        // Endpoints straddle the plane, so dir[axis] cannot be zero here
+        T t = (plane - p0[axis]) / dir[axis];
+        T *p = clipA ? a : b;
+        for (int i = 0; i < 3; ++i)
+            p[i] = p0[i] + t * dir[i];
+        p[axis] = plane;  // Snap exactly onto the plane
+
+        if (clipA) {
+            ta = t; errA = pointErr; maskA |= bit;
+            codeA = computeOutCodeT(a, errA, maskA, ambiguous);
         } else {
-            // Clipping needed
-            int outcodeOut = outcode0 ? outcode0 : outcode1;
-            float x, y, z;
-
-            // Intersect with appropriate plane
-            if (outcodeOut & TOP) {
-                y = ymax;
-                float t = (ymax - y0) / (y1 - y0);
-                x = x0 + t * (x1 - x0);
-                z = z0 + t * (z1 - z0);
-            } else if (outcodeOut & BOTTOM) {
-                y = ymin;
-                float t = (ymin - y0) / (y1 - y0);
-                x = x0 + t * (x1 - x0);
-                z = z0 + t * (z1 - z0);
-            } else if (outcodeOut & RIGHT) {
-                x = xmax;
-                float t = (xmax - x0) / (x1 - x0);
-                y = y0 + t * (y1 - y0);
-                z = z0 + t * (z1 - z0);
-            } else if (outcodeOut & LEFT) {
-                x = xmin;
-                float t = (xmin - x0) / (x1 - x0);
-                y = y0 + t * (y1 - y0);
-                z = z0 + t * (z1 - z0);
-            } else if (outcodeOut & FAR_) {
-                z = zmax;
-                float t = (zmax - z0) / (z1 - z0);
-                x = x0 + t * (x1 - x0);
-                y = y0 + t * (y1 - y0);
-            } else {
-                z = zmin;
-                float t = (zmin - z0) / (z1 - z0);
-                x = x0 + t * (x1 - x0);
-                y = y0 + t * (y1 - y0);
-            }
-
-            // Update point that lies outside
-            if (outcodeOut == outcode0) {
-                x0 = x; y0 = y; z0 = z;
-                outcode0 = computeOutCode(x0, y0, z0);
-            } else {
-                x1 = x; y1 = y; z1 = z;
-                outcode1 = computeOutCode(x1, y1, z1);
-            }
+            tb = t; errB = pointErr; maskB |= bit;
+            codeB = computeOutCodeT(b, errB, maskB, ambiguous);
         }
     }
-    return accept;
+
+    // A sliver thinner than the error in t may be a grazing miss
+    if ((errA > 0 || errB > 0) && tb - ta <= 8 * u)
+        return CLIP_AMBIGUOUS;
+    return CLIP_ACCEPT;
+}
+
+// Fast single-precision clip with a double-precision re-clip for ambiguous segments.
+// Clips the endpoints in place; returns false if the line lies outside the volume.
+bool cohenSutherlandClipTiered(float& x0, float& y0, float& z0, float& x1, float& y1, float& z1) {
+    const float f0[3] = { x0, y0, z0 };
+    const float f1[3] = { x1, y1, z1 };
+    float fa[3], fb[3];
+    ClipResult r = cohenSutherlandClipT(f0, f1, fa, fb);
+
+    if (r == CLIP_ACCEPT) {
+        x0 = fa[0]; y0 = fa[1]; z0 = fa[2];
+        x1 = fb[0]; y1 = fb[1]; z1 = fb[2];
+        return true;
+    }
+    if (r == CLIP_REJECT)
+        return false;
+
+    // Ambiguous in float: decide in double
+    const double d0[3] = { x0, y0, z0 };
+    const double d1[3] = { x1, y1, z1 };
+    double da[3], db[3];
+    if (cohenSutherlandClipT(d0, d1, da, db, false) == CLIP_REJECT)
+        return false;
+
+    x0 = (float)da[0]; y0 = (float)da[1]; z0 = (float)da[2];
+    x1 = (float)db[0]; y1 = (float)db[1]; z1 = (float)db[2];
+    return true;
+}
+
+// ------------------------------
+// Oriented clipping box (OBB)
+// ------------------------------
+// The box keeps its local extents [xmin, xmax] x [ymin, ymax] x [zmin, zmax];
+// its placement in the world is a rotation R plus a translation T
+// (world = R * local + T). Both directions are cached as 3x4 row-major
+// matrices so a batch of segments pays for the transform once per point
+// instead of six plane dot products per clip.
+struct Segment {
+    float x0, y0, z0;
+    float x1, y1, z1;
+};
+
+float localToWorld[3][4] = {
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0}
+};
+float worldToLocal[3][4] = {
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0}
+};
+
+bool obbMode = false;     // Clip against the oriented box instead of the fixed one
+float boxAngle = 30.0f;   // Yaw of the oriented box around its own centre (degrees)
+
+// Apply a cached 3x4 matrix to a point
+void transformPoint(const float m[3][4], float x, float y, float z, float &ox, float &oy, float &oz) {
+    ox = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+    oy = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+    oz = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+}
+
+// Rebuild both cached matrices from a rotation (row-major 3x3) and translation.
+// The inverse of a rigid transform is [R^T | -R^T * T], so no general inversion is needed.
+void setClipBoxTransform(const float rot[3][3], const float trans[3]) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            localToWorld[i][j] = rot[i][j];
+            worldToLocal[i][j] = rot[j][i];
+        }
+        localToWorld[i][3] = trans[i];
+    }
+    for (int i = 0; i < 3; ++i)
+        worldToLocal[i][3] = -(rot[0][i] * trans[0] + rot[1][i] * trans[1] + rot[2][i] * trans[2]);
+}
+
+// Convenience for the demo: yaw the box around the Y axis through its centre
+void setClipBoxYaw(float degrees) {
+    float r = degrees * 3.14159265f / 180.0f;
+    float c = std::cos(r), s = std::sin(r);
+    float rot[3][3] = {
+        { c, 0, s},
+        { 0, 1, 0},
+        {-s, 0, c}
+    };
+    // Keep the centre fixed: T = centre - R * centre
+    float cx = 0.5f * (xmin + xmax), cy = 0.5f * (ymin + ymax), cz = 0.5f * (zmin + zmax);
+    float trans[3] = {
+        cx - (rot[0][0] * cx + rot[0][1] * cy + rot[0][2] * cz),
+        cy - (rot[1][0] * cx + rot[1][1] * cy + rot[1][2] * cz),
+        cz - (rot[2][0] * cx + rot[2][1] * cy + rot[2][2] * cz)
+    };
+    setClipBoxTransform(rot, trans);
+}
+
+// ------------------------------
+// Clip a batch of world-space segments against the oriented box.
+// Each segment is moved into the box's local frame once, clipped with the
+// axis-aligned outcode clipper, and only accepted segments are mapped back
+// to world space. Returns the number of segments written to 'out'.
+// ------------------------------
+size_t clipSegmentsOBB(const std::vector<Segment>& in, std::vector<Segment>& out) {
+    out.clear();
+    out.reserve(in.size());
+    for (const Segment &s : in) {
+        Segment l;
+        transformPoint(worldToLocal, s.x0, s.y0, s.z0, l.x0, l.y0, l.z0);
+        transformPoint(worldToLocal, s.x1, s.y1, s.z1, l.x1, l.y1, l.z1);
+
+        if (!cohenSutherlandClipTiered(l.x0, l.y0, l.z0, l.x1, l.y1, l.z1))
+            continue;
+
+        Segment w;
+        transformPoint(localToWorld, l.x0, l.y0, l.z0, w.x0, w.y0, w.z0);
+        transformPoint(localToWorld, l.x1, l.y1, l.z1, w.x1, w.y1, w.z1);
+        out.push_back(w);
+    }
+    return out.size();
 }
 
 // ------------------------------
@@ -163,6 +315,7 @@ void drawBox() {
 // Main display function
 // ------------------------------
 void display() {
+    trace_frame_begin();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
 
@@ -178,7 +331,21 @@ void display() {
     glColor3f(0, 0, 1); glVertex3f(0, 0, 0); glVertex3f(0, 0, 4); // Z - blue
     glEnd();
 
-    drawBox(); // Draw clipping box
+    // Draw clipping box (placed by the cached local-to-world matrix in OBB mode)
+    if (obbMode) {
+        float m[16] = {
+            localToWorld[0][0], localToWorld[1][0], localToWorld[2][0], 0,
+            localToWorld[0][1], localToWorld[1][1], localToWorld[2][1], 0,
+            localToWorld[0][2], localToWorld[1][2], localToWorld[2][2], 0,
+            localToWorld[0][3], localToWorld[1][3], localToWorld[2][3], 1
+        };
+        glPushMatrix();
+        glMultMatrixf(m);
+        drawBox();
+        glPopMatrix();
+    } else {
+        drawBox();
+    }
 
     // Draw original line in red
     glColor3f(1, 0, 0);
@@ -196,8 +363,22 @@ void display() {
     // Perform clipping
     float cx0 = x0, cy0 = y_0, cz0 = z0;
     float cx1 = x1, cy1 = y_1, cz1 = z1;
+    bool accepted;
+
+    if (obbMode) {
+        std::vector<Segment> batch = { {x0, y_0, z0, x1, y_1, z1} };
+        std::vector<Segment> clipped;
+        accepted = clipSegmentsOBB(batch, clipped) > 0;
+        if (accepted) {
+            const Segment &c = clipped[0];
+            cx0 = c.x0; cy0 = c.y0; cz0 = c.z0;
+            cx1 = c.x1; cy1 = c.y1; cz1 = c.z1;
+        }
+    } else {
+        accepted = cohenSutherlandClipTiered(cx0, cy0, cz0, cx1, cy1, cz1);
+    }
 
-    if (cohenSutherlandClip(cx0, cy0, cz0, cx1, cy1, cz1)) {
+    if (accepted) {
         // Draw clipped line in cyan
         glColor3f(0.0, 1.0, 1.0);
         glLineWidth(4.0);
@@ -220,19 +401,68 @@ void display() {
         drawText(cx1 + 0.1, cy1 + 0.1, cz1, "C2 " + coordToStr(cx1, cy1, cz1));
     }
 
+    trace_frame_end(); // Stop the replay frame timer before the swap
     glutSwapBuffers();
 }
 
 // ------------------------------
 // Timer function to update rotation
 // ------------------------------
-void timer(int value) {
+void advanceAngle() {
     angle += 0.5;
     if (angle > 360) angle -= 360;
+}
+
+void timer(int value) {
+    advanceAngle();
     glutPostRedisplay();
     glutTimerFunc(16, timer, 0); // ~60 FPS
 }
 
+// ------------------------------
+// Keyboard: O toggles oriented-box clipping, [ and ] rotate the box
+// ------------------------------
+void applyKey(unsigned char key) {
+    if (key == 'o' || key == 'O') {
+        obbMode = !obbMode;
+    } else if (key == '[') {
+        boxAngle -= 5.0f;
+        setClipBoxYaw(boxAngle);
+    } else if (key == ']') {
+        boxAngle += 5.0f;
+        setClipBoxYaw(boxAngle);
+    }
+}
+
+void keyboard(unsigned char key, int x, int y) {
+    if (key == 27) {
+        exit(0);
+    }
+    if (trace_replaying()) return;  // Live input is ignored during replay
+    applyKey(key);
+    trace_record('k', key);
+    glutPostRedisplay();
+}
+
+// ------------------------------
+// Input trace hooks: rotation, clip mode and box yaw are recorded with each event
+// ------------------------------
+void saveTraceState(std::vector<float> &state) {
+    state = { angle, obbMode ? 1.0f : 0.0f, boxAngle };
+}
+
+void loadTraceState(const std::vector<float> &state) {
+    if (state.size() < 3) return;
+    angle = state[0];
+    obbMode = state[1] != 0.0f;
+    boxAngle = state[2];
+    setClipBoxYaw(boxAngle);
+}
+
+void applyTraceEvent(char type, int code) {
+    if (type == 'k') applyKey((unsigned char)code);
+}
+
 // ------------------------------
 // OpenGL Initialization
 // ------------------------------
@@ -241,6 +471,7 @@ void init() {
     glMatrixMode(GL_PROJECTION);
     gluPerspective(60, 1.0, 1.0, 50.0);
     glMatrixMode(GL_MODELVIEW);
+    setClipBoxYaw(boxAngle);  // Cache the oriented box matrices once
 }
 
 // ------------------------------
@@ -248,12 +479,18 @@ void init() {
 // ------------------------------
 int main(int argc, char** argv) {
     glutInit(&argc, argv);
+    TraceHooks hooks = { saveTraceState, loadTraceState, applyTraceEvent, advanceAngle };
+    if (!trace_init(argc, argv, "angle obb_mode box_angle", hooks))
+        return 1;
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowSize(900, 800);
     glutCreateWindow("Cohen-Sutherland 3D Clipping with Rotation and Coordinates");
     init();
     glutDisplayFunc(display);
-    glutTimerFunc(0, timer, 0);
+    glutKeyboardFunc(keyboard);
+    if (!trace_replaying())
+        glutTimerFunc(0, timer, 0);  // Replay drives the rotation from its own clock
+    trace_start();
     glutMainLoop();
     return 0;
 }
@@ -4,6 +4,9 @@
 #include <string>
 #include <iomanip>
 #include <vector>
+#include <cmath>
+#include <limits>
+#include "InputTrace.h"
 
 // Define box (clipping volume) dimensions
 const float xmin = 0.0f, xmax = 5.0f;
@@ -19,6 +22,9 @@ struct Plane {
 };
 
 // Clipping planes for the 3D box (each plane clips part of the volume)
+// The box stays axis-aligned here: oriented-box clipping transforms segments into
+// the box frame so the cheap outcode test can be used, and that clipper lives in
+// Cohen-Sutherland.cpp. Cyrus-Beck already accepts arbitrary planes.
 std::vector<Plane> planes = {
     {{1, 0, 0}, xmin},     // Left plane
     {{-1, 0, 0}, -xmax},   // Right plane
@@ -50,43 +56,96 @@ void parametricLine(float t, float x0, float y0, float z0, float x1, float y1, f
     z = z0 + t * (z1 - z0);
 }
 
-// Compute the dot product of two vectors
-float dotProduct(const float a[3], const float b[3]) {
-    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
-}
+// Precision-tiered Cyrus-Beck clipping.
+// The float pass bounds the rounding error of every plane's numerator and
+// denominator (a 3-term dot product plus one subtraction). When the sign of a
+// denominator is uncertain (near-parallel line) or the entering/leaving t values
+// are closer than their combined error (grazing line), the float result is
+// ambiguous and the segment is re-clipped in double precision.
+enum ClipResult {
+    CLIP_REJECT,
+    CLIP_ACCEPT,
+    CLIP_AMBIGUOUS
+};
+
+// Clip P0-P1 against 'planes' in precision T. On CLIP_ACCEPT, [tEnter, tLeave] is the visible range.
+// With trackError false no error bound is kept, so the result is never ambiguous.
+template <typename T>
+ClipResult cyrusBeckClipT(const T p0[3], const T p1[3], T &tEnter, T &tLeave, bool trackError = true) {
+    const T u = trackError ? std::numeric_limits<T>::epsilon() : 0;
+    const T gamma = 5 * u / (1 - 5 * u);  // Bound for a dot product followed by one subtraction
+    const T dir[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
 
-// Cyrus-Beck line clipping algorithm for 3D
-bool cyrusBeckClip(float &x0, float &y0, float &z0, float &x1, float &y1, float &z1) {
-    float t0 = 0.0f, t1 = 1.0f;  // Range of valid t values for visible portion
-    bool accept = true;
+    T t0 = 0, t1 = 1;
+    T err0 = 0, err1 = 0;  // Error bounds on t0 and t1 (the initial 0 and 1 are exact)
 
     for (const auto &plane : planes) {
-        float p0[3] = {x0, y0, z0};
-        float p1[3] = {x1, y1, z1};
-        float dir[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};  // Direction vector of the line
-        float denom = dotProduct(plane.normal, dir);
-
-        float num = dotProduct(plane.normal, p0) - plane.d;
-
-        if (denom > 0) {  // Line is entering the region
-            float t = -num / denom;
-            if (t > t0) t0 = t;
-        } else if (denom < 0) {  // Line is exiting the region
-            float t = -num / denom;
-            if (t < t1) t1 = t;
-        } else if (num > 0) {  // Line is parallel and outside the plane
-            accept = false;
-            break;
+        const T n[3] = { plane.normal[0], plane.normal[1], plane.normal[2] };
+        T num = n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2] - plane.d;
+        T denom = n[0] * dir[0] + n[1] * dir[1] + n[2] * dir[2];
+
+        T numErr = gamma * (std::fabs(n[0] * p0[0]) + std::fabs(n[1] * p0[1]) + std::fabs(n[2] * p0[2]) + std::fabs((T)plane.d));
+        T denomErr = gamma * (std::fabs(n[0]) * (std::fabs(p0[0]) + std::fabs(p1[0])) +
+                              std::fabs(n[1]) * (std::fabs(p0[1]) + std::fabs(p1[1])) +
+                              std::fabs(n[2]) * (std::fabs(p0[2]) + std::fabs(p1[2])));
+
+        if (std::fabs(denom) <= denomErr) {
+            // Parallel to the plane (or too close to tell): inside test on P0 decides
+            if (trackError && (denom != 0 || std::fabs(num) <= numErr))
+                return CLIP_AMBIGUOUS;
+            if (num < 0)
+                return CLIP_REJECT;
+            continue;
+        }
+
+        T t = -num / denom;
+        T tErr = (numErr + std::fabs(t) * denomErr) / (std::fabs(denom) - denomErr) + 2 * u * std::fabs(t);
+        if (denom > 0) {         // Entering
+            if (t > t0) { t0 = t; err0 = tErr; }
+        } else {                 // Leaving
+            if (t < t1) { t1 = t; err1 = tErr; }
         }
     }
 
-    // If line lies partially or completely inside the volume
-    if (accept && t0 < t1) {
-        parametricLine(t0, x0, y0, z0, x1, y1, z1, x0, y0, z0);
-        parametricLine(t1, x0, y0, z0, x1, y1, z1, x1, y1, z1);
+    if (std::fabs(t1 - t0) <= err0 + err1 && (err0 > 0 || err1 > 0))
+        return CLIP_AMBIGUOUS;
+    if (t0 > t1)
+        return CLIP_REJECT;
+
+    tEnter = t0;
+    tLeave = t1;
+    return CLIP_ACCEPT;
+}
+
+// Fast single-precision clip with a double-precision re-clip for ambiguous segments.
+// Clips the endpoints in place; returns false if the line misses the volume.
+bool cyrusBeckClipTiered(float &x0, float &y0, float &z0, float &x1, float &y1, float &z1) {
+    const float f0[3] = { x0, y0, z0 };
+    const float f1[3] = { x1, y1, z1 };
+    float ft0, ft1;
+    ClipResult r = cyrusBeckClipT(f0, f1, ft0, ft1);
+
+    if (r == CLIP_REJECT)
+        return false;
+    if (r == CLIP_ACCEPT) {
+        // Leave endpoints untouched when they are not clipped
+        float ox0 = x0, oy0 = y0, oz0 = z0;
+        if (ft0 > 0.0f) parametricLine(ft0, ox0, oy0, oz0, x1, y1, z1, x0, y0, z0);
+        if (ft1 < 1.0f) parametricLine(ft1, ox0, oy0, oz0, x1, y1, z1, x1, y1, z1);
+        return true;
     }
 
-    return accept;
+    // Ambiguous in float: decide in double
+    const double d0[3] = { x0, y0, z0 };
+    const double d1[3] = { x1, y1, z1 };
+    double dt0 = 0, dt1 = 1;
+    if (cyrusBeckClipT(d0, d1, dt0, dt1, false) == CLIP_REJECT)
+        return false;
+
+    double dx = d1[0] - d0[0], dy = d1[1] - d0[1], dz = d1[2] - d0[2];
+    x0 = (float)(d0[0] + dt0 * dx); y0 = (float)(d0[1] + dt0 * dy); z0 = (float)(d0[2] + dt0 * dz);
+    x1 = (float)(d0[0] + dt1 * dx); y1 = (float)(d0[1] + dt1 * dy); z1 = (float)(d0[2] + dt1 * dz);
+    return true;
 }
 
 // Original 3D line endpoints (before clipping)
@@ -119,6 +178,7 @@ void drawBox() {
 
 // Display callback: renders scene and performs clipping
 void display() {
+    trace_frame_begin();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
     gluLookAt(10, 8, 10, 2.5, 2, 1.5, 0, 1, 0);  // Set camera view
@@ -152,7 +212,7 @@ void display() {
     float cx1 = x1, cy1 = y_1, cz1 = z1;
 
     // Perform clipping and draw clipped line
-    if (cyrusBeckClip(cx0, cy0, cz0, cx1, cy1, cz1)) {
+    if (cyrusBeckClipTiered(cx0, cy0, cz0, cx1, cy1, cz1)) {
         // Draw clipped segment (cyan)
         glColor3f(0.0, 1.0, 1.0);
         glLineWidth(4.0);
@@ -175,17 +235,32 @@ void display() {
         drawText(cx1 + 0.1, cy1 + 0.1, cz1, "C2 " + coordToStr(cx1, cy1, cz1));
     }
 
+    trace_frame_end();  // Stop the replay frame timer before the swap
     glutSwapBuffers();  // Swap front and back buffers for smooth animation
 }
 
-// Timer function for rotating the scene
-void timer(int value) {
+// Advance the rotation by one frame (also driven by trace replay)
+void advanceAngle() {
     angle += 0.5;  // Increment angle for rotation
     if (angle > 360) angle -= 360;
+}
+
+// Timer function for rotating the scene
+void timer(int value) {
+    advanceAngle();
     glutPostRedisplay();  // Request display update
     glutTimerFunc(16, timer, 0);  // Re-register timer for ~60 FPS
 }
 
+// Input trace hooks: the rotation angle is the only recorded state
+void saveTraceState(std::vector<float> &state) {
+    state = { angle };
+}
+
+void loadTraceState(const std::vector<float> &state) {
+    if (!state.empty()) angle = state[0];
+}
+
 // OpenGL initialization
 void init() {
     glEnable(GL_DEPTH_TEST);  // Enable depth buffering
@@ -197,12 +272,17 @@ void init() {
 // Main program entry point
 int main(int argc, char** argv) {
     glutInit(&argc, argv);
+    TraceHooks hooks = { saveTraceState, loadTraceState, nullptr, advanceAngle };
+    if (!trace_init(argc, argv, "angle", hooks))  // Record/replay options
+        return 1;
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowSize(900, 800);
     glutCreateWindow("Cyrus-Beck 3D Clipping with Rotation and Coordinates");
     init();
     glutDisplayFunc(display);      // Register display callback
-    glutTimerFunc(0, timer, 0);    // Start timer
+    if (!trace_replaying())
+        glutTimerFunc(0, timer, 0);  // Start timer (replay drives the rotation itself)
+    trace_start();                   // Begin recording or replaying if requested
     glutMainLoop();                // Enter event loop
     return 0;
 }
@@ -0,0 +1,228 @@
+// Input trace record/replay shared by the demos (for repeatable performance runs)
+//
+// --record FILE   writes every input event with its timestamp and the demo state it produced
+// --replay FILE   replays the trace on a fixed virtual clock and prints frame-time percentiles
+//   --fps N       virtual frame rate (default 60)
+//   --fast        render as fast as possible instead of pacing frames
+//
+// A demo describes its state through TraceHooks; everything else lives here.
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include <GL/glut.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Demo-specific callbacks used by the recorder and the replay driver
+struct TraceHooks {
+    void (*save_state)(std::vector<float> &state);        // Snapshot the demo state
+    void (*load_state)(const std::vector<float> &state);  // Restore a recorded snapshot
+    void (*apply_event)(char type, int code);             // Re-run a 'k' or 's' event (may be null)
+    void (*advance_frame)();                              // Fixed per-frame animation step (may be null)
+};
+
+enum TraceMode { TRACE_NONE, TRACE_RECORD, TRACE_REPLAY };
+
+// One recorded input event plus the state it produced
+struct TraceEvent {
+    double time_ms;            // Milliseconds since recording started
+    char type;                 // 'i' initial state, 'k' keyboard, 's' special key, 'e' end of session
+    int code;                  // Key code passed to the handler
+    std::vector<float> state;  // Demo state after the event
+};
+
+static TraceMode trace_mode = TRACE_NONE;
+static TraceHooks trace_hooks;
+static std::ofstream trace_out;                               // Open while recording
+static std::chrono::steady_clock::time_point record_start;    // When recording began
+static std::vector<TraceEvent> trace_events;                  // Loaded events when replaying
+static size_t next_event = 0;                                 // Next event to apply
+static double replay_clock_ms = 0.0;                          // Virtual time of the replay
+static int replay_fps = 60;                                   // Fixed virtual frame rate
+static bool replay_fast = false;                              // Render as fast as possible instead of pacing
+static std::vector<double> frame_times_ms;                    // Measured time for each replayed frame
+static std::chrono::steady_clock::time_point frame_start;     // Start of the frame being timed
+
+inline bool trace_replaying() {
+    return trace_mode == TRACE_REPLAY;
+}
+
+// Append an event and the resulting demo state to the trace file
+inline void trace_record(char type, int code) {
+    if (trace_mode != TRACE_RECORD) return;
+    std::chrono::duration<double, std::milli> since_start = std::chrono::steady_clock::now() - record_start;
+    long t = (type == 'i') ? 0 : (long)since_start.count();
+
+    std::vector<float> state;
+    trace_hooks.save_state(state);
+    trace_out << t << ' ' << type << ' ' << code;
+    for (float v : state)
+        trace_out << ' ' << v;
+    trace_out << '\n';
+    trace_out.flush(); // Keep the trace intact if the window is closed
+}
+
+// Mark the end of the session so replay keeps any idle time after the last key.
+// Registered with atexit, so it runs for ESC and for closing the window.
+inline void trace_record_end() {
+    trace_record('e', 0);
+}
+
+// Load a trace written by trace_record; returns false if the file is unusable
+inline bool trace_load(const char *path) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        TraceEvent ev;
+        if (!(ss >> ev.time_ms >> ev.type >> ev.code))
+            return false;
+        float v;
+        while (ss >> v)
+            ev.state.push_back(v);
+        trace_events.push_back(ev);
+    }
+    return !trace_events.empty();
+}
+
+// Nearest-rank percentile of a sorted sample
+inline double trace_percentile(const std::vector<double> &sorted, double p) {
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+// Print frame-time statistics for the replay and quit
+inline void trace_finish_replay() {
+    std::vector<double> sorted = frame_times_ms;
+    std::sort(sorted.begin(), sorted.end());
+    printf("Replayed %zu events over %zu frames (%s, %d fps virtual clock)\n",
+           trace_events.size(), sorted.size(), replay_fast ? "unpaced" : "paced", replay_fps);
+    if (!sorted.empty()) {
+        printf("Frame time ms  p50: %.3f  p99: %.3f  max: %.3f\n",
+               trace_percentile(sorted, 50), trace_percentile(sorted, 99), sorted.back());
+    }
+    exit(0);
+}
+
+// Advance the virtual clock by one frame and apply every event that falls inside it.
+// The recorded state is restored after each event, so the replay reproduces the
+// session exactly even if the key handlers change. The replay runs until the
+// clock reaches the final event (the 'e' end marker in complete traces).
+inline void trace_replay_step() {
+    if (next_event >= trace_events.size()) {
+        trace_finish_replay();
+        return;
+    }
+
+    replay_clock_ms += 1000.0 / replay_fps;
+    if (trace_hooks.advance_frame) trace_hooks.advance_frame();
+    while (next_event < trace_events.size() && trace_events[next_event].time_ms <= replay_clock_ms) {
+        const TraceEvent &ev = trace_events[next_event++];
+        if ((ev.type == 'k' || ev.type == 's') && trace_hooks.apply_event)
+            trace_hooks.apply_event(ev.type, ev.code);
+        trace_hooks.load_state(ev.state);
+    }
+
+    glutPostRedisplay();
+}
+
+// Replay driver for paced runs (one frame per timer tick)
+inline void trace_replay_timer(int value) {
+    trace_replay_step();
+    glutTimerFunc(1000 / replay_fps, trace_replay_timer, 0);
+}
+
+// Replay driver for unpaced runs (next frame as soon as the last one is done)
+inline void trace_replay_idle() {
+    trace_replay_step();
+}
+
+// Call at the top of the display callback
+inline void trace_frame_begin() {
+    frame_start = std::chrono::steady_clock::now();
+}
+
+// Call just before glutSwapBuffers: waits for the GPU and stops the clock before
+// the swap, so the vsync wait is not counted (frames drawn before the first replay
+// step are not counted either)
+inline void trace_frame_end() {
+    if (trace_mode == TRACE_REPLAY && replay_clock_ms > 0.0) {
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frame_start;
+        frame_times_ms.push_back(elapsed.count());
+    }
+}
+
+// Print command-line usage
+inline void trace_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--record FILE | --replay FILE [--fps N] [--fast]]\n", prog);
+}
+
+// Parse the trace options (call after glutInit, which removes its own arguments)
+// and open or load the trace. 'columns' names the state values for the file header.
+// Returns false after printing a message if the options or the file are unusable.
+inline bool trace_init(int argc, char **argv, const char *columns, TraceHooks hooks) {
+    trace_hooks = hooks;
+
+    const char *trace_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            trace_mode = TRACE_RECORD;
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            trace_mode = TRACE_REPLAY;
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+            replay_fps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--fast")) {
+            replay_fast = true;
+        } else {
+            trace_usage(argv[0]);
+            return false;
+        }
+    }
+    if (replay_fps <= 0) {
+        trace_usage(argv[0]);
+        return false;
+    }
+
+    if (trace_mode == TRACE_RECORD) {
+        trace_out.open(trace_path);
+        if (!trace_out) {
+            fprintf(stderr, "Cannot write trace file %s\n", trace_path);
+            return false;
+        }
+        trace_out << "# time_ms type code " << columns << '\n';
+    } else if (trace_mode == TRACE_REPLAY && !trace_load(trace_path)) {
+        fprintf(stderr, "Cannot read trace file %s\n", trace_path);
+        return false;
+    }
+    return true;
+}
+
+// Call once the GLUT callbacks are registered: writes the initial state when
+// recording, or starts the replay driver when replaying
+inline void trace_start() {
+    if (trace_mode == TRACE_RECORD) {
+        record_start = std::chrono::steady_clock::now();
+        trace_record('i', 0); // Starting state
+        atexit(trace_record_end);
+    } else if (trace_mode == TRACE_REPLAY) {
+        if (replay_fast) glutIdleFunc(trace_replay_idle);
+        else glutTimerFunc(0, trace_replay_timer, 0);
+    }
+}
+
+#endif // INPUT_TRACE_H